@@ -18,204 +18,1606 @@
 #include <math.h>
 
 #define STACK_BLOCK_SIZE 10
+#define TABLE_BLOCK_SIZE 64
+#define NAME_BUCKET_BLOCK_SIZE 16
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define HASH_WORD_PRIME 0x9E3779B97F4A7C15ULL
+
+/* handles and subscription ids keep a table index in their low bits and a
+** generation in the rest, bumped each time the index is reused.
+*/
+#define HANDLE_INDEX_BITS 24
+#define HANDLE_INDEX(handle) ((handle) & ((1u << HANDLE_INDEX_BITS) - 1))
+#define HANDLE_REUSE(handle) ((handle) + (1u << HANDLE_INDEX_BITS))
 
 /******************************************************************************
  * MARK: TYPE DEFINITIONS
  *****************************************************************************/
 
-typedef struct {
-    nGraphNode_h* data;
-    size_t size;
-    size_t capacity;
-} Stack;
+typedef struct {
+    nGraphNode** data;
+    size_t size;
+    size_t capacity;
+} Stack;
+
+typedef struct {
+    uint32_t* data;
+    size_t size;
+    size_t capacity;
+} FreeList;
+
+typedef struct {
+    const char* name;
+    uint64_t hash;
+} InternedName;
+
+typedef struct {
+    const char* name;
+    uint64_t hash;
+    nGraphNode_h node;
+    uint32_t next;
+} NameIndexEntry;
+
+typedef struct {
+    nGraphNode_h root;
+
+    /* name index, chained buckets of entries. Entry 0 is reserved so that 0
+    ** terminates a chain.
+    */
+    uint32_t* nameBuckets;
+    size_t nameBucketCount;
+    NameIndexEntry* nameEntries;
+    size_t nameEntryCount;
+    size_t nameEntryCapacity;
+    size_t nameLiveCount;
+    FreeList freeNameEntries;
+
+    // cached fragmentation, cleared by insertion and removal in the graph
+    float fragmentation;
+    int fragmentationValid;
+} GraphState;
+
+typedef struct {
+    // id handed out for this slot, with its generation
+    nGraphSubscription id;
+    // NANOGRAPH_NULL_HANDLE marks a free slot
+    nGraphNode_h node;
+    // next subscription on the same node, 0 ending the list
+    uint32_t nextForNode;
+    int wholeGraph;
+    nGraphLayoutCallback callback;
+    void* userData;
+} Subscription;
+
+typedef struct {
+    // root of the graph the pass ran on
+    nGraphNode_h root;
+    size_t start;
+    size_t count;
+} LayoutBatch;
+
+typedef struct {
+    float left;
+    float top;
+    float right;
+    float bottom;
+} ClipBounds;
+
+typedef struct {
+    nGraphNode* node;
+    nGraphNode* nextChild;
+
+    // space offered to the next child, reduced by earlier docked siblings
+    nGraphSize remaining;
+} MeasureFrame;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t nodeCount;
+
+    /* arrangement of the descendants in pre-order, relative to the subtree
+    ** root, recorded the second time the subtree is laid out at arrangedSize.
+    */
+    nGraphSize arrangedSize;
+    nGraphRect* rects;
+} MemoEntry;
+
+_Static_assert(sizeof(nGraphNode) <= NANOGRAPH_NODE_BYTE_BUDGET,
+               "nGraphNode exceeds NANOGRAPH_NODE_BYTE_BUDGET");
+
+
+/******************************************************************************
+ * MARK: LOCAL FUNCTION PROTOTYPES
+ *****************************************************************************/
+
+
+void MeasureNode(nGraphNode* node);
+void LayoutNode(nGraphNode* node);
+
+// Space a parent offers its first child, derived from the parent's available size
+nGraphSize ChildAvailableSize(nGraphNode* node);
+// Take a measured child's size out of the space its dock parent has left
+void ConsumeDockSpace(MeasureFrame* frame, nGraphNode* child);
+// Check if measuring a clean node under a constraint would reproduce its last result
+int SameMeasureResult(nGraphNode* node, nGraphSize available);
+
+// Allocate a zeroed node slot and a handle for it, which may move the node store
+nGraphNode* AllocateNode();
+// Resolve a slot index, returning NULL for NANOGRAPH_NULL_INDEX
+nGraphNode* NodeAt(nGraphNodeIndex slot);
+// Resolve a handle, returning NULL for a null or released handle
+nGraphNode* Resolve(nGraphNode_h handle);
+// Slot index of a node in the node store
+nGraphNodeIndex SlotOf(nGraphNode* node);
+// Release a node's side table slots, name, handle and slot
+void ReleaseNode(nGraphNode* node, GraphState* graph);
+// Find the root of the graph a node belongs to
+nGraphNode* RootOf(nGraphNode* node);
+// Mark a node and its ancestors as needing measurement
+void MarkMeasureDirty(nGraphNode* node);
+// Arrange the outermost deferred ancestor of a node, if any
+void ArrangeDeferredFrom(nGraphNode* node);
+// Grid properties of a node, or NULL
+nGraphParentGridProperties* GridPropertiesOf(nGraphNode* node);
+
+// Push a free slot for reuse
+void FreeList_Push(FreeList* list, uint32_t slot);
+// Pop a free slot, returning 0 if there is none
+uint32_t FreeList_Pop(FreeList* list);
+
+// Find the state of a graph by its root, optionally creating it
+GraphState* FindGraph(nGraphNode* root, int create);
+// Free a graph's state and remove it from the graph table
+void DestroyGraph(GraphState* graph);
+
+// Look up the interned copy of a name, optionally interning it
+const char* InternName(const char* name, uint64_t hash, int insert);
+// Add a node to a graph's name index under an interned name
+void NameIndex_Insert(GraphState* graph, const char* name, uint64_t hash, nGraphNode_h node);
+// Remove a node from its graph's name index, if it is indexed
+void NameIndex_Remove(GraphState* graph, nGraphNode_h node);
+// Rebuild the bucket chains with a new bucket count
+void NameIndex_Rehash(GraphState* graph, size_t bucketCount);
+
+// Grow a table so it can hold at least the required number of elements
+void* GrowTable(void* table, size_t* capacity, size_t elementSize, size_t required);
+
+// Next node in pre-order, without leaving the subtree under root
+nGraphNode* NextInSubtree(nGraphNode* node, nGraphNode* root);
+// Share of pre-order neighbours in a subtree that aren't adjacent in memory
+float Fragmentation(nGraphNode* root);
+// Fragmentation of a whole graph, only walked again after a structural change
+float GraphFragmentation(nGraphNode* root);
+
+// Add a subscription, returning its handle
+nGraphSubscription AddSubscription(nGraphNode* node, int wholeGraph, nGraphLayoutCallback callback, void* userData);
+// Unlink a subscription slot from its node's list and free it
+void RemoveSubscription(uint32_t subscription);
+// Drop every subscription on a node
+void RemoveSubscriptions(nGraphNode_h node);
+// First subscription on a node, or 0
+uint32_t FirstSubscription(nGraphNode_h node);
+// Copy a node's child rects before its layout overwrites them
+void SnapshotChildRects(nGraphNode* node);
+// Queue events for children whose rects differ from the snapshot
+void CollectChildChanges(nGraphNode* node);
+// Queue an event if a node's rect differs from its previous value
+void QueueLayoutEvent(nGraphNode* node, nGraphRect oldRect);
+// Close the batch of events queued by a pass over a graph
+void EndLayoutBatch(nGraphNode_h root, size_t start);
+// Deliver queued batches to the subscribers of their graphs and nodes
+void DeliverLayoutEvents();
+
+// Fold bytes into an FNV-1a hash
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size);
+// Fold 32-bit words into a hash, size being a multiple of 4
+uint64_t HashWords(uint64_t hash, const void* data, size_t size);
+// Hash the layout inputs of a node and its already hashed children
+uint64_t HashSubtree(nGraphNode* node, uint32_t* nodeCount);
+
+// Store the subtree hash of a node that has just been measured
+void UpdateSubtreeHash(nGraphNode* node);
+// Find the cache entry for a node's subtree, or NULL
+MemoEntry* FindMemoEntry(nGraphNode* node);
+// Arrange a subtree from a cached arrangement, returning 0 if none applies
+int ApplyMemoArrangement(nGraphNode* node);
+// Record the arrangement of a subtree that has just been laid out
+void RecordMemoArrangement(nGraphNode* node);
+
+// Lay out a subtree top-down, optionally deferring children outside the clip
+void ArrangeSubtree(nGraphNode* root, ClipBounds clip, int cull);
+
+// Narrow clip bounds to a rect
+ClipBounds ClipToRect(ClipBounds clip, nGraphRect rect);
+// Check if a rect overlaps clip bounds
+int RectIntersectsClip(nGraphRect rect, ClipBounds clip);
+// Check if a node's layout assigns the rects of its children
+int AssignsChildRects(nGraphNode* node);
+
+// Initialize the measure and down stacks
+void InitializeStacks(size_t initialCapacity);
+// Free the stacks when no longer needed
+void FreeStacks();
+
+// Push a node onto the down stack
+void DownStack_Push(nGraphNode* node);
+
+// Pop a node from the down stack
+nGraphNode* DownStack_Pop();
+// Check if the down stack is empty
+int DownStack_IsEmpty();
+
+// Push a node onto the down stack along with its inherited clip bounds
+void DownStack_PushClipped(nGraphNode* node, ClipBounds clip);
+// Pop a node from the down stack along with its inherited clip bounds
+nGraphNode* DownStack_PopClipped(ClipBounds* clip);
+// Reverse the down stack above start so siblings pop in document order
+void DownStack_ReverseFrom(size_t start);
+
+// Push a node onto the measure stack, before its children are measured
+void MeasureStack_Push(nGraphNode* node);
+
+/******************************************************************************
+ * MARK: LOCAL VARIABLES
+ *****************************************************************************/
+
+static nGraphNode **downStack = NULL;
+static ClipBounds *downClipStack = NULL;
+static size_t downStackSize = 0;
+static size_t downStatckCapacity = 0;
+
+static MeasureFrame *measureStack = NULL;
+static size_t measureStackSize = 0;
+static size_t measureStackCapacity = 0;
+
+static size_t nodeQty = 0;
+
+/* nodes live in one array addressed by slot, slot 0 being reserved for
+** NANOGRAPH_NULL_INDEX. Handles map to slots, so compaction can move nodes
+** without invalidating them, and a released handle maps to slot 0.
+*/
+static nGraphNode *nodes = NULL;
+static size_t nodeSlotCount = 0;
+static size_t nodeSlotCapacity = 0;
+
+static nGraphNodeIndex *handleSlots = NULL;
+static size_t handleCount = 0;
+static size_t handleCapacity = 0;
+
+/* side tables for payloads most nodes don't have, slot 0 meaning none */
+static nGraphParentGridProperties *gridTable = NULL;
+static size_t gridTableSize = 0;
+static size_t gridTableCapacity = 0;
+
+static nDrawing *drawingTable = NULL;
+static size_t drawingTableSize = 0;
+static size_t drawingTableCapacity = 0;
+
+/* slots released by NanoGraph_RemoveNode, reused before tables grow */
+static FreeList freeSlots = { 0 };
+static FreeList freeHandles = { 0 };
+static FreeList freeGridSlots = { 0 };
+static FreeList freeDrawingSlots = { 0 };
+
+/* graphs that hold per-graph state, keyed by root handle */
+static GraphState *graphs = NULL;
+static size_t graphCount = 0;
+static size_t graphCapacity = 0;
+
+/* names are stored once and shared by every node and graph using them */
+static InternedName *internTable = NULL;
+static size_t internTableCount = 0;
+static size_t internTableCapacity = 0;
+
+/* name index entry of each handle, 0 meaning none. Removal goes through
+** this rather than node->name, which the caller may have overwritten.
+*/
+static uint32_t *nameEntryOf = NULL;
+static size_t nameEntryOfCapacity = 0;
+
+/* structural memoisation, a direct-mapped cache of subtree hashes */
+static MemoEntry *memoCache = NULL;
+static size_t memoCapacity = 0;
+static nGraphMemoStats memoStats = { 0 };
+
+static uint64_t *subtreeHashes = NULL;
+static size_t subtreeHashesCapacity = 0;
+static uint32_t *subtreeSizes = NULL;
+static size_t subtreeSizesCapacity = 0;
+
+/* layout change subscriptions, and event buffers kept between passes */
+static Subscription *subscriptions = NULL;
+static size_t subscriptionCount = 0;
+static size_t subscriptionCapacity = 0;
+static size_t liveSubscriptions = 0;
+static FreeList freeSubscriptions = { 0 };
+
+/* first subscription of each handle, so delivery and removal only walk the
+** subscriptions of the node concerned.
+*/
+static uint32_t *subscriptionHeads = NULL;
+static size_t subscriptionHeadsCapacity = 0;
+
+/* passes queue events and batches into one pair of buffers while the other
+** pair is delivered, so passes run from a callback are delivered afterwards.
+*/
+static nGraphLayoutEvent *layoutEvents = NULL;
+static size_t layoutEventCount = 0;
+static size_t layoutEventCapacity = 0;
+static LayoutBatch *layoutBatches = NULL;
+static size_t layoutBatchCount = 0;
+static size_t layoutBatchCapacity = 0;
+
+static nGraphLayoutEvent *deliveryEvents = NULL;
+static size_t deliveryEventCapacity = 0;
+static LayoutBatch *deliveryBatches = NULL;
+static size_t deliveryBatchCapacity = 0;
+
+static nGraphRect *rectSnapshot = NULL;
+static size_t rectSnapshotCapacity = 0;
+static int collectingLayoutEvents = 0;
+static int deliveringLayoutEvents = 0;
+
+/* fragmentation above which NanoGraph_Recalculate compacts, 0 disables */
+static float compactionThreshold = 0;
+
+static int memoArrangeActive = 0;
+static nGraphNode_h memoPendingNode = NANOGRAPH_NULL_HANDLE;
+static size_t memoPendingDepth = 0;
+
+static int clipCullingEnabled = 0;
+
+static int measureCachingEnabled = 0;
+
+static const ClipBounds unboundedClip = { -INFINITY, -INFINITY, INFINITY, INFINITY };
+
+
+/******************************************************************************
+ * MARK: GLOBAL FUNCTION IMPLEMENTATIONS
+ *****************************************************************************/
+
+nGraphNode_h NanoGraph_CreateRootNode()
+{
+    nGraphNode* node = AllocateNode();
+
+    printf("Created root node with ID %u\n", node->handle);
+
+     nodeQty++;
+    FreeStacks();
+    InitializeStacks(nodeQty);
+
+    return node->handle;
+}
+
+nGraphNode_h NanoGraph_InsertNode(nGraphNode_h parentHandle)
+{
+    if (Resolve(parentHandle) == NULL) return NANOGRAPH_NULL_HANDLE;
+
+    // allocating may move the node store, so the parent is resolved afterwards
+    nGraphNode* node = AllocateNode();
+    nGraphNode* parent = Resolve(parentHandle);
+
+    //printf("Created child node with ID %u\n", node->handle);
+
+    // Add child to the end of the parent's sibling list
+    node->parent = SlotOf(parent);
+
+    if (parent->lastChild == NANOGRAPH_NULL_INDEX) {
+        parent->firstChild = SlotOf(node);
+    } else {
+        NodeAt(parent->lastChild)->next = SlotOf(node);
+    }
+
+    parent->lastChild = SlotOf(node);
+
+    MarkMeasureDirty(parent);
+
+    GraphState* graph = FindGraph(RootOf(parent), 0);
+    if (graph != NULL) {
+        graph->fragmentationValid = 0;
+    }
+
+    nodeQty++;
+    FreeStacks();
+    InitializeStacks(nodeQty);
+
+    return node->handle;
+}
+
+void NanoGraph_RemoveNode(nGraphNode_h handle)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL) return;
+
+    nGraphNode* parent = NodeAt(node->parent);
+    GraphState* graph = FindGraph(RootOf(node), 0);
+
+    // Unlink the node from its parent's sibling list
+    if (parent != NULL) {
+        if (parent->firstChild == SlotOf(node)) {
+            parent->firstChild = node->next;
+        } else {
+            nGraphNode* previous = NodeAt(parent->firstChild);
+            while (previous->next != SlotOf(node)) {
+                previous = NodeAt(previous->next);
+            }
+            previous->next = node->next;
+
+            if (parent->lastChild == SlotOf(node)) {
+                parent->lastChild = SlotOf(previous);
+            }
+        }
+
+        if (parent->firstChild == NANOGRAPH_NULL_INDEX) {
+            parent->lastChild = NANOGRAPH_NULL_INDEX;
+        }
+
+        MarkMeasureDirty(parent);
+    }
+
+    // Release the subtree, reading each node's children before its slot is freed
+    DownStack_Push(node);
+    while (!DownStack_IsEmpty()) {
+        nGraphNode* current = DownStack_Pop();
+
+        for (nGraphNode* child = NodeAt(current->firstChild); child != NULL; child = NodeAt(child->next)) {
+            DownStack_Push(child);
+        }
+
+        ReleaseNode(current, graph);
+    }
+
+    if (parent == NULL && graph != NULL) {
+        DestroyGraph(graph);
+    } else if (graph != NULL) {
+        graph->fragmentationValid = 0;
+    }
+
+    FreeStacks();
+    InitializeStacks(nodeQty);
+}
+
+void NanoGraph_Recalculate(nGraphNode_h root) {
+    nGraphSize unbounded = { INFINITY, INFINITY };
+    NanoGraph_RecalculateWithSize(root, unbounded);
+}
+
+void NanoGraph_RecalculateWithSize(nGraphNode_h rootHandle, nGraphSize availableSize) {
+    nGraphNode* root = Resolve(rootHandle);
+    if (root == NULL) return;
+
+    if (memoCache != NULL) {
+        subtreeHashes = (uint64_t*)GrowTable(subtreeHashes, &subtreeHashesCapacity, sizeof(uint64_t), handleCount);
+        subtreeSizes = (uint32_t*)GrowTable(subtreeSizes, &subtreeSizesCapacity, sizeof(uint32_t), handleCount);
+    }
+
+    /* Measure depth-first, visiting children in order so a dock child is
+    ** offered only the space its earlier siblings left. A node is measured once
+    ** all of its children have been.
+    */
+    if (!measureCachingEnabled || root->measureDirty || !SameMeasureResult(root, availableSize)) {
+        root->availableSize = availableSize;
+        MeasureStack_Push(root);
+    }
+
+    while (measureStackSize > 0) {
+        MeasureFrame* frame = &measureStack[measureStackSize - 1];
+        nGraphNode* child = frame->nextChild;
+
+        if (child == NULL) {
+            nGraphNode* node = frame->node;
+            measureStackSize--;
+
+            /* subtree hashes are only updated for measured nodes, so a clean
+            ** subtree skipped by measure caching keeps its earlier hashes.
+            */
+            MeasureNode(node);
+            if (memoCache != NULL) {
+                UpdateSubtreeHash(node);
+            }
+            node->measureDirty = 0;
+
+            if (measureStackSize > 0) {
+                ConsumeDockSpace(&measureStack[measureStackSize - 1], node);
+            }
+            continue;
+        }
+
+        frame->nextChild = NodeAt(child->next);
+
+        // With caching, a clean child whose new constraint gives the same result keeps its measured subtree.
+        if (measureCachingEnabled && !child->measureDirty && SameMeasureResult(child, frame->remaining)) {
+            ConsumeDockSpace(frame, child);
+            continue;
+        }
+
+        child->availableSize = frame->remaining;
+        MeasureStack_Push(child);
+    }
+
+    // Traverse down the tree to layout nodes
+    memoArrangeActive = (memoCache != NULL);
+    ArrangeSubtree(root, unboundedClip, clipCullingEnabled);
+    memoArrangeActive = 0;
+
+    // layout callbacks may have inserted nodes and moved the store
+    root = Resolve(rootHandle);
+
+    /* measured over the whole graph, since nodes skipped by caching or
+    ** culling would otherwise look like breaks in the visiting order.
+    */
+    if (compactionThreshold > 0 && root != NULL && GraphFragmentation(RootOf(root)) > compactionThreshold) {
+        NanoGraph_Compact();
+    }
+}
+
+void NanoGraph_SetMeasureCaching(int enabled)
+{
+    measureCachingEnabled = enabled;
+}
+
+void NanoGraph_InvalidateMeasure(nGraphNode_h node)
+{
+    MarkMeasureDirty(Resolve(node));
+}
+
+void NanoGraph_Compact()
+{
+    if (nodeSlotCount <= 1) return;
+
+    /* every graph is copied into a new store in depth-first order, one block
+    ** per graph, and links are rewritten through a map from old to new slots.
+    ** Handles are remapped to the new slots so they stay valid.
+    */
+    nGraphNodeIndex* slotMap = (nGraphNodeIndex*)calloc(nodeSlotCount, sizeof(nGraphNodeIndex));
+    nGraphNode* compacted = (nGraphNode*)malloc((nodeQty + 1) * sizeof(nGraphNode));
+    size_t compactedCount = 1;
+
+    memset(&compacted[0], 0, sizeof(nGraphNode));
+
+    for (size_t slot = 1; slot < nodeSlotCount; slot++) {
+        nGraphNode* root = &nodes[slot];
+        if (root->handle == NANOGRAPH_NULL_HANDLE || root->parent != NANOGRAPH_NULL_INDEX) continue;
+
+        for (nGraphNode* node = root; node != NULL; node = NextInSubtree(node, root)) {
+            slotMap[SlotOf(node)] = (nGraphNodeIndex)compactedCount;
+            compacted[compactedCount++] = *node;
+        }
+    }
+
+    for (size_t slot = 1; slot < compactedCount; slot++) {
+        nGraphNode* node = &compacted[slot];
+        node->parent = slotMap[node->parent];
+        node->firstChild = slotMap[node->firstChild];
+        node->lastChild = slotMap[node->lastChild];
+        node->next = slotMap[node->next];
+
+        handleSlots[HANDLE_INDEX(node->handle)] = (nGraphNodeIndex)slot;
+    }
+
+    free(slotMap);
+    free(nodes);
+
+    nodes = compacted;
+    nodeSlotCount = compactedCount;
+    nodeSlotCapacity = nodeQty + 1;
+    freeSlots.size = 0;
+
+    // every graph is now contiguous
+    for (size_t i = 0; i < graphCount; i++) {
+        graphs[i].fragmentation = 0;
+        graphs[i].fragmentationValid = 1;
+    }
+}
+
+float NanoGraph_GetFragmentation(nGraphNode_h root)
+{
+    return Fragmentation(Resolve(root));
+}
+
+void NanoGraph_SetCompactionThreshold(float threshold)
+{
+    compactionThreshold = threshold;
+}
+
+nGraphNode_h NanoGraph_GetNextNode(nGraphNode_h handle)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL) return NANOGRAPH_NULL_HANDLE;
+
+    // If the node has children, return the first child
+    if (node->firstChild != NANOGRAPH_NULL_INDEX) {
+        return NodeAt(node->firstChild)->handle;
+    }
+
+    // Traverse up the tree to find the next sibling
+    while (node != NULL) {
+        // If there is a next sibling, return it
+        if (node->next != NANOGRAPH_NULL_INDEX) {
+            return NodeAt(node->next)->handle;
+        }
+
+        // Move up to the parent node
+        node = NodeAt(node->parent);
+    }
+
+    // If no next node is found, return NULL
+    return NANOGRAPH_NULL_HANDLE;
+}
+
+void NanoGraph_SetClipCulling(int enabled)
+{
+    clipCullingEnabled = enabled;
+}
+
+void NanoGraph_ArrangeDeferred(nGraphNode_h node)
+{
+    ArrangeDeferredFrom(Resolve(node));
+}
+
+nGraphRect NanoGraph_GetCalculatedRect(nGraphNode_h handle)
+{
+    nGraphRect empty = { 0 };
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL) return empty;
+
+    // a node's own rect is assigned by its parent's layout
+    ArrangeDeferredFrom(NodeAt(node->parent));
+
+    // layout callbacks may have moved the store or removed the node
+    node = Resolve(handle);
+    return (node != NULL) ? node->calculatedRect : empty;
+}
+
+nGraphNode* NanoGraph_GetNode(nGraphNode_h node)
+{
+    return Resolve(node);
+}
+
+nGraphNode_h NanoGraph_GetParent(nGraphNode_h handle)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL || node->parent == NANOGRAPH_NULL_INDEX) return NANOGRAPH_NULL_HANDLE;
+    return NodeAt(node->parent)->handle;
+}
+
+nGraphNode_h NanoGraph_GetFirstChild(nGraphNode_h handle)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL || node->firstChild == NANOGRAPH_NULL_INDEX) return NANOGRAPH_NULL_HANDLE;
+    return NodeAt(node->firstChild)->handle;
+}
+
+nGraphNode_h NanoGraph_GetNextSibling(nGraphNode_h handle)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL || node->next == NANOGRAPH_NULL_INDEX) return NANOGRAPH_NULL_HANDLE;
+    return NodeAt(node->next)->handle;
+}
+
+void NanoGraph_SetGridProperties(nGraphNode_h handle, nGraphParentGridProperties properties)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL) return;
+
+    if (node->gridIndex == 0) {
+        node->gridIndex = FreeList_Pop(&freeGridSlots);
+    }
+
+    if (node->gridIndex == 0) {
+        // slot 0 is reserved to mean the node has no grid
+        if (gridTableSize == 0) gridTableSize = 1;
+
+        gridTable = (nGraphParentGridProperties*)GrowTable(gridTable, &gridTableCapacity, sizeof(nGraphParentGridProperties), gridTableSize + 1);
+        node->gridIndex = (uint32_t)gridTableSize++;
+    }
+
+    gridTable[node->gridIndex] = properties;
+}
+
+nGraphParentGridProperties* NanoGraph_GetGridProperties(nGraphNode_h node)
+{
+    return GridPropertiesOf(Resolve(node));
+}
+
+void NanoGraph_SetDrawing(nGraphNode_h handle, nDrawing drawing)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL) return;
+
+    if (node->drawingIndex == 0) {
+        node->drawingIndex = FreeList_Pop(&freeDrawingSlots);
+    }
+
+    if (node->drawingIndex == 0) {
+        // slot 0 is reserved to mean the node has no drawing
+        if (drawingTableSize == 0) drawingTableSize = 1;
+
+        drawingTable = (nDrawing*)GrowTable(drawingTable, &drawingTableCapacity, sizeof(nDrawing), drawingTableSize + 1);
+        node->drawingIndex = (uint32_t)drawingTableSize++;
+    }
+
+    drawingTable[node->drawingIndex] = drawing;
+}
+
+nDrawing* NanoGraph_GetDrawing(nGraphNode_h handle)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL || node->drawingIndex == 0) return NULL;
+    return &drawingTable[node->drawingIndex];
+}
+
+void NanoGraph_SetName(nGraphNode_h handle, const char* name)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL) return;
+
+    GraphState* graph = FindGraph(RootOf(node), 1);
+
+    NameIndex_Remove(graph, node->handle);
+    node->name = NULL;
+
+    if (name == NULL) return;
+
+    uint64_t hash = HashBytes(FNV_OFFSET_BASIS, name, strlen(name));
+    node->name = InternName(name, hash, 1);
+
+    NameIndex_Insert(graph, node->name, hash, node->handle);
+}
+
+nGraphNode_h NanoGraph_FindNode(nGraphNode_h root, const char* name)
+{
+    nGraphNode_h node = NANOGRAPH_NULL_HANDLE;
+    NanoGraph_FindNodes(root, name, &node, 1);
+    return node;
+}
+
+size_t NanoGraph_FindNodes(nGraphNode_h rootHandle, const char* name, nGraphNode_h* nodes, size_t maxNodes)
+{
+    nGraphNode* root = Resolve(rootHandle);
+    if (root == NULL || name == NULL) return 0;
+
+    GraphState* graph = FindGraph(RootOf(root), 0);
+    if (graph == NULL || graph->nameLiveCount == 0) return 0;
+
+    // names are interned, so entries can be matched by pointer
+    uint64_t hash = HashBytes(FNV_OFFSET_BASIS, name, strlen(name));
+    const char* interned = InternName(name, hash, 0);
+    if (interned == NULL) return 0;
+
+    size_t found = 0;
+    uint32_t entry = graph->nameBuckets[hash & (graph->nameBucketCount - 1)];
+    while (entry != 0) {
+        if (graph->nameEntries[entry].name == interned) {
+            if (found < maxNodes) {
+                nodes[found] = graph->nameEntries[entry].node;
+            }
+            found++;
+        }
+        entry = graph->nameEntries[entry].next;
+    }
+
+    return found;
+}
+
+nGraphSubscription NanoGraph_SubscribeNode(nGraphNode_h handle, nGraphLayoutCallback callback, void* userData)
+{
+    nGraphNode* node = Resolve(handle);
+    if (node == NULL || callback == NULL) return 0;
+    return AddSubscription(node, 0, callback, userData);
+}
+
+nGraphSubscription NanoGraph_SubscribeGraph(nGraphNode_h handle, nGraphLayoutCallback callback, void* userData)
+{
+    nGraphNode* root = Resolve(handle);
+    if (root == NULL || callback == NULL) return 0;
+    return AddSubscription(RootOf(root), 1, callback, userData);
+}
+
+void NanoGraph_Unsubscribe(nGraphSubscription subscription)
+{
+    uint32_t index = HANDLE_INDEX(subscription);
+    if (index == 0 || index >= subscriptionCount) return;
+
+    // an id whose slot has been freed or reused is stale
+    nGraphNode_h node = subscriptions[index].node;
+    if (node == NANOGRAPH_NULL_HANDLE || subscriptions[index].id != subscription) return;
+
+    RemoveSubscription(index);
+
+    // keep the flag only while the node has another subscription
+    Resolve(node)->hasSubscriber = (FirstSubscription(node) != 0);
+}
+
+void NanoGraph_SetSubtreeMemoisation(size_t capacity)
+{
+    for (size_t i = 0; i < memoCapacity; i++) {
+        free(memoCache[i].rects);
+    }
+    free(memoCache);
+
+    memoCache = NULL;
+    memoCapacity = 0;
+    memoStats.entries = 0;
+
+    if (capacity == 0) {
+        free(subtreeHashes);
+        free(subtreeSizes);
+        subtreeHashes = NULL;
+        subtreeSizes = NULL;
+        subtreeHashesCapacity = 0;
+        subtreeSizesCapacity = 0;
+        return;
+    }
+
+    // round up to a power of two so a hash can be masked into a slot
+    memoCapacity = 1;
+    while (memoCapacity < capacity) {
+        memoCapacity *= 2;
+    }
+
+    memoCache = (MemoEntry*)calloc(memoCapacity, sizeof(MemoEntry));
+
+    // nodes skipped by measure caching need their subtree hashes computed once
+    for (size_t slot = 1; slot < nodeSlotCount; slot++) {
+        if (nodes[slot].handle != NANOGRAPH_NULL_HANDLE) {
+            nodes[slot].measureDirty = 1;
+        }
+    }
+}
+
+nGraphMemoStats NanoGraph_GetMemoStats()
+{
+    return memoStats;
+}
+
+
+/******************************************************************************
+ * MARK: LOCAL FUNCTION IMPLEMENTATIONS
+ *****************************************************************************/
+
+
+nGraphNode* AllocateNode()
+{
+    // slot 0 and handle 0 are reserved for the null values
+    if (nodeSlotCount == 0) {
+        nodes = (nGraphNode*)GrowTable(nodes, &nodeSlotCapacity, sizeof(nGraphNode), 1);
+        memset(&nodes[nodeSlotCount++], 0, sizeof(nGraphNode));
+    }
+
+    if (handleCount == 0) {
+        handleSlots = (nGraphNodeIndex*)GrowTable(handleSlots, &handleCapacity, sizeof(nGraphNodeIndex), 1);
+        handleSlots[handleCount++] = NANOGRAPH_NULL_INDEX;
+    }
+
+    nGraphNodeIndex slot = FreeList_Pop(&freeSlots);
+    if (slot == NANOGRAPH_NULL_INDEX) {
+        nodes = (nGraphNode*)GrowTable(nodes, &nodeSlotCapacity, sizeof(nGraphNode), nodeSlotCount + 1);
+        slot = (nGraphNodeIndex)nodeSlotCount++;
+    }
+
+    // a released handle comes back with a new generation
+    nGraphNode_h handle = FreeList_Pop(&freeHandles);
+    if (handle != NANOGRAPH_NULL_HANDLE) {
+        handle = HANDLE_REUSE(handle);
+    } else {
+        handleSlots = (nGraphNodeIndex*)GrowTable(handleSlots, &handleCapacity, sizeof(nGraphNodeIndex), handleCount + 1);
+        handle = (nGraphNode_h)handleCount++;
+    }
+
+    nGraphNode* node = &nodes[slot];
+    memset(node, 0, sizeof(nGraphNode));
+
+    node->handle = handle;
+    node->measureDirty = 1;
+
+    handleSlots[HANDLE_INDEX(handle)] = slot;
+
+    return node;
+}
+
+void ReleaseNode(nGraphNode* node, GraphState* graph)
+{
+    if (graph != NULL) {
+        NameIndex_Remove(graph, node->handle);
+    }
+
+    if (node->gridIndex != 0) {
+        FreeList_Push(&freeGridSlots, node->gridIndex);
+    }
+
+    if (node->drawingIndex != 0) {
+        FreeList_Push(&freeDrawingSlots, node->drawingIndex);
+    }
+
+    if (node->hasSubscriber) {
+        RemoveSubscriptions(node->handle);
+    }
+
+    handleSlots[HANDLE_INDEX(node->handle)] = NANOGRAPH_NULL_INDEX;
+    FreeList_Push(&freeHandles, node->handle);
+    FreeList_Push(&freeSlots, SlotOf(node));
+
+    // a free slot has no handle, which NanoGraph_Compact uses to skip it
+    node->handle = NANOGRAPH_NULL_HANDLE;
+    nodeQty--;
+}
+
+nGraphNode* RootOf(nGraphNode* node)
+{
+    while (node->parent != NANOGRAPH_NULL_INDEX) {
+        node = NodeAt(node->parent);
+    }
+    return node;
+}
+
+void MarkMeasureDirty(nGraphNode* node)
+{
+    /* a dirty node always has dirty ancestors, since they are cleared
+    ** together by the measure pass, so the walk can stop at the first one.
+    */
+    while (node != NULL && !node->measureDirty) {
+        node->measureDirty = 1;
+        node = NodeAt(node->parent);
+    }
+}
+
+void ArrangeDeferredFrom(nGraphNode* node)
+{
+    /* descendants of a deferred node are not flagged themselves, so the
+    ** outermost deferred ancestor is the one that needs arranging.
+    */
+    nGraphNode* deferred = NULL;
+    for (nGraphNode* current = node; current != NULL; current = NodeAt(current->parent)) {
+        if (current->arrangeDeferred) {
+            deferred = current;
+        }
+    }
+
+    if (deferred == NULL) return;
+
+    // the subtree was culled because it is off screen, so arrange it in full
+    ArrangeSubtree(deferred, unboundedClip, 0);
+}
+
+nGraphParentGridProperties* GridPropertiesOf(nGraphNode* node)
+{
+    if (node == NULL || node->gridIndex == 0) return NULL;
+    return &gridTable[node->gridIndex];
+}
+
+void FreeList_Push(FreeList* list, uint32_t slot)
+{
+    list->data = (uint32_t*)GrowTable(list->data, &list->capacity, sizeof(uint32_t), list->size + 1);
+    list->data[list->size++] = slot;
+}
+
+uint32_t FreeList_Pop(FreeList* list)
+{
+    if (list->size == 0) return 0;
+    return list->data[--list->size];
+}
+
+GraphState* FindGraph(nGraphNode* root, int create)
+{
+    for (size_t i = 0; i < graphCount; i++) {
+        if (graphs[i].root == root->handle) {
+            return &graphs[i];
+        }
+    }
+
+    if (!create) return NULL;
+
+    graphs = (GraphState*)GrowTable(graphs, &graphCapacity, sizeof(GraphState), graphCount + 1);
+
+    GraphState* graph = &graphs[graphCount++];
+    memset(graph, 0, sizeof(GraphState));
+    graph->root = root->handle;
+
+    // entry 0 terminates bucket chains
+    graph->nameEntryCount = 1;
+    graph->nameEntries = (NameIndexEntry*)GrowTable(NULL, &graph->nameEntryCapacity, sizeof(NameIndexEntry), 1);
+    NameIndex_Rehash(graph, NAME_BUCKET_BLOCK_SIZE);
+
+    return graph;
+}
+
+void DestroyGraph(GraphState* graph)
+{
+    free(graph->nameBuckets);
+    free(graph->nameEntries);
+    free(graph->freeNameEntries.data);
+
+    *graph = graphs[--graphCount];
+}
+
+const char* InternName(const char* name, uint64_t hash, int insert)
+{
+    if (internTableCapacity > 0) {
+        size_t mask = internTableCapacity - 1;
+        for (size_t slot = hash & mask; internTable[slot].name != NULL; slot = (slot + 1) & mask) {
+            if (internTable[slot].hash == hash && strcmp(internTable[slot].name, name) == 0) {
+                return internTable[slot].name;
+            }
+        }
+    }
 
+    if (!insert) return NULL;
 
-/******************************************************************************
- * MARK: LOCAL FUNCTION PROTOTYPES
- *****************************************************************************/
+    // keep the open-addressed table at most half full
+    if ((internTableCount + 1) * 2 > internTableCapacity) {
+        size_t oldCapacity = internTableCapacity;
+        InternedName* oldTable = internTable;
 
+        internTableCapacity = (oldCapacity == 0) ? TABLE_BLOCK_SIZE : oldCapacity * 2;
+        internTable = (InternedName*)calloc(internTableCapacity, sizeof(InternedName));
 
-void MeasureNode(nGraphNode_h node);
-void LayoutNode(nGraphNode_h node);
+        for (size_t i = 0; i < oldCapacity; i++) {
+            if (oldTable[i].name == NULL) continue;
 
-// Initialize the up and down stacks
-void InitializeStacks(size_t initialCapacity);
-// Free the stacks when no longer needed
-void FreeStacks();
+            size_t slot = oldTable[i].hash & (internTableCapacity - 1);
+            while (internTable[slot].name != NULL) {
+                slot = (slot + 1) & (internTableCapacity - 1);
+            }
+            internTable[slot] = oldTable[i];
+        }
 
-// Push a node onto the down stack
-void DownStack_Push(nGraphNode_h node);
+        free(oldTable);
+    }
 
-// Pop a node from the down stack
-nGraphNode_h DownStack_Pop();
-// Check if the down stack is empty
-int DownStack_IsEmpty();
+    size_t length = strlen(name) + 1;
+    char* copy = (char*)malloc(length);
+    memcpy(copy, name, length);
 
-// Push a node onto the up stack
-void UpStack_Push(nGraphNode_h node);
+    size_t slot = hash & (internTableCapacity - 1);
+    while (internTable[slot].name != NULL) {
+        slot = (slot + 1) & (internTableCapacity - 1);
+    }
 
-// Pop a node from the up stack
-nGraphNode_h UpStack_Pop();
-// Check if the up stack is empty
-int UpStack_IsEmpty();
+    internTable[slot].name = copy;
+    internTable[slot].hash = hash;
+    internTableCount++;
 
-/******************************************************************************
- * MARK: LOCAL VARIABLES
- *****************************************************************************/
+    return copy;
+}
 
-static nGraphNode_h *downStack = NULL;
-static size_t downStackSize = 0;
-static size_t downStatckCapacity = 0;
+void NameIndex_Insert(GraphState* graph, const char* name, uint64_t hash, nGraphNode_h node)
+{
+    uint32_t entry = FreeList_Pop(&graph->freeNameEntries);
+    if (entry == 0) {
+        graph->nameEntries = (NameIndexEntry*)GrowTable(graph->nameEntries, &graph->nameEntryCapacity, sizeof(NameIndexEntry), graph->nameEntryCount + 1);
+        entry = (uint32_t)graph->nameEntryCount++;
+    }
 
-static nGraphNode_h *upStack = NULL;
-static size_t upStackSize = 0;
-static size_t upStatckCapacity = 0;
+    size_t bucket = hash & (graph->nameBucketCount - 1);
 
-static size_t nodeQty = 0;
+    graph->nameEntries[entry].name = name;
+    graph->nameEntries[entry].hash = hash;
+    graph->nameEntries[entry].node = node;
+    graph->nameEntries[entry].next = graph->nameBuckets[bucket];
+    graph->nameBuckets[bucket] = entry;
+
+    uint32_t index = HANDLE_INDEX(node);
+    if (index >= nameEntryOfCapacity) {
+        size_t oldCapacity = nameEntryOfCapacity;
+        nameEntryOf = (uint32_t*)GrowTable(nameEntryOf, &nameEntryOfCapacity, sizeof(uint32_t), index + 1);
+        memset(&nameEntryOf[oldCapacity], 0, (nameEntryOfCapacity - oldCapacity) * sizeof(uint32_t));
+    }
+    nameEntryOf[index] = entry;
 
+    graph->nameLiveCount++;
+    if (graph->nameLiveCount > graph->nameBucketCount) {
+        NameIndex_Rehash(graph, graph->nameBucketCount * 2);
+    }
+}
 
-/******************************************************************************
- * MARK: GLOBAL FUNCTION IMPLEMENTATIONS
- *****************************************************************************/
+void NameIndex_Remove(GraphState* graph, nGraphNode_h node)
+{
+    uint32_t index = HANDLE_INDEX(node);
+    if (index >= nameEntryOfCapacity || nameEntryOf[index] == 0) return;
 
-nGraphNode_h NanoGraph_CreateRootNode()
+    // the entry keeps the hash it was indexed under, which locates its bucket
+    uint32_t target = nameEntryOf[index];
+    uint32_t* link = &graph->nameBuckets[graph->nameEntries[target].hash & (graph->nameBucketCount - 1)];
+
+    while (*link != target) {
+        link = &graph->nameEntries[*link].next;
+    }
+
+    *link = graph->nameEntries[target].next;
+    graph->nameEntries[target].name = NULL;
+    FreeList_Push(&graph->freeNameEntries, target);
+    graph->nameLiveCount--;
+
+    nameEntryOf[index] = 0;
+}
+
+void NameIndex_Rehash(GraphState* graph, size_t bucketCount)
 {
-    nGraphNode_h node = (nGraphNode_h)malloc(sizeof(nGraphNode));
-    memset(node, 0, sizeof(nGraphNode));
+    free(graph->nameBuckets);
+    graph->nameBuckets = (uint32_t*)calloc(bucketCount, sizeof(uint32_t));
+    graph->nameBucketCount = bucketCount;
 
-    printf("Created root node with ID %lu\n", node);
+    for (uint32_t entry = 1; entry < graph->nameEntryCount; entry++) {
+        if (graph->nameEntries[entry].name == NULL) continue;
 
-     nodeQty++;
-    FreeStacks();
-    InitializeStacks(nodeQty);
+        size_t bucket = graph->nameEntries[entry].hash & (bucketCount - 1);
+        graph->nameEntries[entry].next = graph->nameBuckets[bucket];
+        graph->nameBuckets[bucket] = entry;
+    }
+}
 
-    return node;
+nGraphNode* NodeAt(nGraphNodeIndex slot)
+{
+    return (slot == NANOGRAPH_NULL_INDEX) ? NULL : &nodes[slot];
 }
 
-nGraphNode_h NanoGraph_InsertNode(nGraphNode_h parent)
+nGraphNode* Resolve(nGraphNode_h handle)
 {
-    if (parent == NULL) return NULL;
+    uint32_t index = HANDLE_INDEX(handle);
+    if (index == 0 || index >= handleCount) return NULL;
 
-    nGraphNode_h node = (nGraphNode_h)malloc(sizeof(nGraphNode));
-    memset(node, 0, sizeof(nGraphNode));
+    // a released or reused handle no longer matches the node in its slot
+    nGraphNode* node = NodeAt(handleSlots[index]);
+    return (node != NULL && node->handle == handle) ? node : NULL;
+}
+
+nGraphNodeIndex SlotOf(nGraphNode* node)
+{
+    return (nGraphNodeIndex)(node - nodes);
+}
+
+nGraphNode* NextInSubtree(nGraphNode* node, nGraphNode* root)
+{
+    if (node->firstChild != NANOGRAPH_NULL_INDEX) {
+        return NodeAt(node->firstChild);
+    }
+
+    while (node != root) {
+        if (node->next != NANOGRAPH_NULL_INDEX) {
+            return NodeAt(node->next);
+        }
+        node = NodeAt(node->parent);
+    }
+
+    return NULL;
+}
+
+float Fragmentation(nGraphNode* root)
+{
+    if (root == NULL) return 0;
+
+    // a break is a pre-order neighbour that isn't the next slot in the store
+    size_t visited = 0;
+    size_t breaks = 0;
+    nGraphNode* previous = NULL;
+
+    for (nGraphNode* node = root; node != NULL; node = NextInSubtree(node, root)) {
+        if (previous != NULL && node != previous + 1) {
+            breaks++;
+        }
+        previous = node;
+        visited++;
+    }
+
+    if (visited < 2) return 0;
+    return (float)breaks / (float)(visited - 1);
+}
+
+float GraphFragmentation(nGraphNode* root)
+{
+    GraphState* graph = FindGraph(root, 1);
+
+    if (!graph->fragmentationValid) {
+        graph->fragmentation = Fragmentation(root);
+        graph->fragmentationValid = 1;
+    }
 
-    //printf("Created child node with ID %lu\n", node);
+    return graph->fragmentation;
+}
+
+nGraphSubscription AddSubscription(nGraphNode* node, int wholeGraph, nGraphLayoutCallback callback, void* userData)
+{
+    // slot 0 is reserved so 0 can mean no subscription
+    if (subscriptionCount == 0) {
+        subscriptions = (Subscription*)GrowTable(subscriptions, &subscriptionCapacity, sizeof(Subscription), 1);
+        memset(&subscriptions[subscriptionCount++], 0, sizeof(Subscription));
+    }
 
-    // Add child to parent
-    if (parent->children == NULL) {
-        parent->children = (nGraphNode_h*)malloc(sizeof(nGraphNode_h));
+    // a freed slot is reused under a new generation of its id
+    uint32_t subscription = FreeList_Pop(&freeSubscriptions);
+    nGraphSubscription id;
+    if (subscription != 0) {
+        id = HANDLE_REUSE(subscriptions[subscription].id);
     } else {
-        parent->children = (nGraphNode_h*)realloc(parent->children, (parent->child_count + 1) * sizeof(nGraphNode_h));
+        subscriptions = (Subscription*)GrowTable(subscriptions, &subscriptionCapacity, sizeof(Subscription), subscriptionCount + 1);
+        subscription = (uint32_t)subscriptionCount++;
+        id = subscription;
     }
 
-    node->parent = parent;
+    uint32_t index = HANDLE_INDEX(node->handle);
+    if (index >= subscriptionHeadsCapacity) {
+        size_t oldCapacity = subscriptionHeadsCapacity;
+        subscriptionHeads = (uint32_t*)GrowTable(subscriptionHeads, &subscriptionHeadsCapacity, sizeof(uint32_t), index + 1);
+        memset(&subscriptionHeads[oldCapacity], 0, (subscriptionHeadsCapacity - oldCapacity) * sizeof(uint32_t));
+    }
 
-    parent->children[parent->child_count++] = node;
+    subscriptions[subscription].id = id;
+    subscriptions[subscription].node = node->handle;
+    subscriptions[subscription].nextForNode = 0;
+    subscriptions[subscription].wholeGraph = wholeGraph;
+    subscriptions[subscription].callback = callback;
+    subscriptions[subscription].userData = userData;
+
+    // appended so a node's subscribers are called in the order they subscribed
+    uint32_t* link = &subscriptionHeads[index];
+    while (*link != 0) {
+        link = &subscriptions[*link].nextForNode;
+    }
+    *link = subscription;
 
-    nodeQty++;
-    FreeStacks();
-    InitializeStacks(nodeQty);
+    node->hasSubscriber = 1;
+    liveSubscriptions++;
 
-    return node;
+    return id;
 }
 
-void NanoGraph_Recalculate(nGraphNode_h root) {
-    if (root == NULL) return;
+void RemoveSubscription(uint32_t subscription)
+{
+    uint32_t* link = &subscriptionHeads[HANDLE_INDEX(subscriptions[subscription].node)];
+    while (*link != subscription) {
+        link = &subscriptions[*link].nextForNode;
+    }
+    *link = subscriptions[subscription].nextForNode;
 
-    // Use the down stack to traverse the tree for measurement
-    DownStack_Push(root);
+    subscriptions[subscription].node = NANOGRAPH_NULL_HANDLE;
+    FreeList_Push(&freeSubscriptions, subscription);
+    liveSubscriptions--;
+}
 
-    // Temporary stack to reverse the order
-    while (!DownStack_IsEmpty()) {
-        nGraphNode_h node = DownStack_Pop();
-        UpStack_Push(node);
+void RemoveSubscriptions(nGraphNode_h node)
+{
+    uint32_t index = HANDLE_INDEX(node);
+    while (subscriptionHeads[index] != 0) {
+        RemoveSubscription(subscriptionHeads[index]);
+    }
+}
+
+uint32_t FirstSubscription(nGraphNode_h node)
+{
+    uint32_t index = HANDLE_INDEX(node);
+    if (index >= subscriptionHeadsCapacity) return 0;
+    return subscriptionHeads[index];
+}
+
+void SnapshotChildRects(nGraphNode* node)
+{
+    // nodes don't store a child count, so the snapshot grows as it is filled
+    size_t i = 0;
+    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
+        rectSnapshot = (nGraphRect*)GrowTable(rectSnapshot, &rectSnapshotCapacity, sizeof(nGraphRect), i + 1);
+        rectSnapshot[i++] = child->calculatedRect;
+    }
+}
+
+void CollectChildChanges(nGraphNode* node)
+{
+    size_t i = 0;
+    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
+        QueueLayoutEvent(child, rectSnapshot[i++]);
+    }
+}
+
+void QueueLayoutEvent(nGraphNode* node, nGraphRect oldRect)
+{
+    nGraphRect newRect = node->calculatedRect;
+    if (oldRect.x == newRect.x && oldRect.y == newRect.y
+        && oldRect.width == newRect.width && oldRect.height == newRect.height) {
+        return;
+    }
+
+    layoutEvents = (nGraphLayoutEvent*)GrowTable(layoutEvents, &layoutEventCapacity, sizeof(nGraphLayoutEvent), layoutEventCount + 1);
+
+    layoutEvents[layoutEventCount].node = node->handle;
+    layoutEvents[layoutEventCount].oldRect = oldRect;
+    layoutEvents[layoutEventCount].newRect = newRect;
+    layoutEventCount++;
+}
+
+void EndLayoutBatch(nGraphNode_h root, size_t start)
+{
+    if (layoutEventCount == start) return;
+
+    layoutBatches = (LayoutBatch*)GrowTable(layoutBatches, &layoutBatchCapacity, sizeof(LayoutBatch), layoutBatchCount + 1);
+
+    layoutBatches[layoutBatchCount].root = root;
+    layoutBatches[layoutBatchCount].start = start;
+    layoutBatches[layoutBatchCount].count = layoutEventCount - start;
+    layoutBatchCount++;
+}
+
+void DeliverLayoutEvents()
+{
+    // batches queued by a callback are picked up by the delivery already running
+    if (deliveringLayoutEvents) return;
+    deliveringLayoutEvents = 1;
+
+    while (layoutBatchCount > 0) {
+        /* swap the buffers, so passes run from a callback queue into the other
+        ** pair and the events being delivered stay where they are.
+        */
+        nGraphLayoutEvent* events = layoutEvents;
+        size_t eventCapacity = layoutEventCapacity;
+        LayoutBatch* batches = layoutBatches;
+        size_t batchCapacity = layoutBatchCapacity;
+        size_t batchCount = layoutBatchCount;
+
+        layoutEvents = deliveryEvents;
+        layoutEventCapacity = deliveryEventCapacity;
+        layoutEventCount = 0;
+        layoutBatches = deliveryBatches;
+        layoutBatchCapacity = deliveryBatchCapacity;
+        layoutBatchCount = 0;
+
+        for (size_t b = 0; b < batchCount; b++) {
+            nGraphLayoutEvent* batch = &events[batches[b].start];
+            nGraphNode_h root = batches[b].root;
+
+            /* the next link is read first, since a callback may unsubscribe
+            ** itself. Events hold handles, since callbacks may remove nodes.
+            */
+            uint32_t next = 0;
+            for (uint32_t i = FirstSubscription(root); i != 0 && subscriptions[i].node == root; i = next) {
+                next = subscriptions[i].nextForNode;
+                if (subscriptions[i].wholeGraph) {
+                    subscriptions[i].callback(batch, batches[b].count, subscriptions[i].userData);
+                }
+            }
 
-        // Push children onto the down stack
-        for (size_t i = node->child_count; i > 0; --i) {
-            DownStack_Push(node->children[i - 1]);
+            for (size_t e = 0; e < batches[b].count; e++) {
+                nGraphNode_h handle = batch[e].node;
+                nGraphNode* node = Resolve(handle);
+                if (node == NULL || !node->hasSubscriber) continue;
+
+                for (uint32_t i = FirstSubscription(handle); i != 0 && subscriptions[i].node == handle; i = next) {
+                    next = subscriptions[i].nextForNode;
+                    if (!subscriptions[i].wholeGraph) {
+                        subscriptions[i].callback(&batch[e], 1, subscriptions[i].userData);
+                    }
+                }
+            }
         }
+
+        deliveryEvents = events;
+        deliveryEventCapacity = eventCapacity;
+        deliveryBatches = batches;
+        deliveryBatchCapacity = batchCapacity;
     }
 
-    // Process nodes in reverse order for measurement
-    while (!UpStack_IsEmpty()) {
-        nGraphNode_h node = UpStack_Pop();
-        MeasureNode(node);
+    deliveringLayoutEvents = 0;
+}
+
+uint64_t HashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
     }
+    return hash;
+}
 
-    // Push root node to down stack for layout
-    DownStack_Push(root);
+uint64_t HashWords(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i += sizeof(uint32_t)) {
+        uint32_t word;
+        memcpy(&word, bytes + i, sizeof(word));
 
-    // Traverse down the tree to layout nodes
-    while (!DownStack_IsEmpty()) {
-        nGraphNode_h node = DownStack_Pop();
-        LayoutNode(node);
+        hash = (hash ^ word) * HASH_WORD_PRIME;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
 
-        // Push children onto the down stack in reverse order
-        for (size_t i = node->child_count; i > 0; --i) {
-            DownStack_Push(node->children[i - 1]);
+uint64_t HashSubtree(nGraphNode* node, uint32_t* nodeCount)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    uint32_t flags = node->parentLayout
+                   | (node->parentStackOrientation << 2)
+                   | (node->childDockPosition << 3)
+                   | (node->childHorizontalAlignment << 5)
+                   | (node->childVerticalAlignment << 7);
+
+    // every hashed field is made of 32-bit floats and integers
+    hash = HashWords(hash, &flags, sizeof(flags));
+    hash = HashWords(hash, &node->availableSize, sizeof(node->availableSize));
+    hash = HashWords(hash, &node->userRect, sizeof(node->userRect));
+    hash = HashWords(hash, &node->margin, sizeof(node->margin));
+    hash = HashWords(hash, &node->padding, sizeof(node->padding));
+    hash = HashWords(hash, &node->childGridPosition, sizeof(node->childGridPosition));
+
+    nGraphParentGridProperties* grid = GridPropertiesOf(node);
+    if (grid != NULL) {
+        hash = HashWords(hash, &grid->rows, sizeof(grid->rows));
+        hash = HashWords(hash, &grid->columns, sizeof(grid->columns));
+        for (size_t i = 0; i < grid->rows && grid->rowSizes != NULL; i++) {
+            hash = HashWords(hash, &grid->rowSizes[i].unit, sizeof(grid->rowSizes[i].unit));
+            hash = HashWords(hash, &grid->rowSizes[i].value, 3 * sizeof(float));
+        }
+        for (size_t i = 0; i < grid->columns && grid->columnSizes != NULL; i++) {
+            hash = HashWords(hash, &grid->columnSizes[i].unit, sizeof(grid->columnSizes[i].unit));
+            hash = HashWords(hash, &grid->columnSizes[i].value, 3 * sizeof(float));
         }
     }
+
+    /* children are measured first, so their subtree hashes are already known.
+    ** A count of 0 marks a subtree that can't be reused, because a layout in
+    ** it leaves child rects unassigned and a replay would overwrite them.
+    */
+    int reusable = (node->firstChild == NANOGRAPH_NULL_INDEX) || AssignsChildRects(node);
+
+    *nodeCount = 1;
+    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
+        uint32_t childCount = subtreeSizes[HANDLE_INDEX(child->handle)];
+
+        hash = HashWords(hash, &subtreeHashes[HANDLE_INDEX(child->handle)], sizeof(uint64_t));
+        *nodeCount += childCount;
+        reusable = reusable && (childCount != 0);
+    }
+
+    if (!reusable) {
+        *nodeCount = 0;
+    }
+
+    // 0 marks an empty cache slot
+    return (hash == 0) ? 1 : hash;
 }
 
-nGraphNode_h NanoGraph_GetNextNode(nGraphNode_h node)
+void UpdateSubtreeHash(nGraphNode* node)
 {
-    if (node == NULL) return NULL;
+    uint32_t nodeCount = 0;
+    subtreeHashes[HANDLE_INDEX(node->handle)] = HashSubtree(node, &nodeCount);
+    subtreeSizes[HANDLE_INDEX(node->handle)] = nodeCount;
+}
 
-    // If the node has children, return the first child
-    if (node->child_count > 0) {
-        return node->children[0];
+MemoEntry* FindMemoEntry(nGraphNode* node)
+{
+    if (HANDLE_INDEX(node->handle) >= subtreeHashesCapacity || subtreeSizes[HANDLE_INDEX(node->handle)] <= 1) return NULL;
+
+    uint64_t hash = subtreeHashes[HANDLE_INDEX(node->handle)];
+    MemoEntry* entry = &memoCache[hash & (memoCapacity - 1)];
+
+    if (entry->hash != hash || entry->nodeCount != subtreeSizes[HANDLE_INDEX(node->handle)]) return NULL;
+    return entry;
+}
+
+int ApplyMemoArrangement(nGraphNode* node)
+{
+    // laying out a leaf is cheaper than a cache lookup
+    if (HANDLE_INDEX(node->handle) >= subtreeHashesCapacity || subtreeSizes[HANDLE_INDEX(node->handle)] <= 1) return 0;
+
+    MemoEntry* entry = FindMemoEntry(node);
+
+    /* the first time a subtree is seen it only claims a slot, so subtrees
+    ** that never repeat don't pay for recording an arrangement.
+    */
+    if (entry == NULL) {
+        entry = &memoCache[subtreeHashes[HANDLE_INDEX(node->handle)] & (memoCapacity - 1)];
+
+        if (entry->hash != 0) {
+            free(entry->rects);
+            memoStats.evictions++;
+        } else {
+            memoStats.entries++;
+        }
+
+        entry->hash = subtreeHashes[HANDLE_INDEX(node->handle)];
+        entry->nodeCount = subtreeSizes[HANDLE_INDEX(node->handle)];
+        entry->rects = NULL;
+
+        memoStats.misses++;
+        return 0;
     }
 
-    // Traverse up the tree to find the next sibling
-    while (node->parent != NULL) {
-        nGraphNode_h parent = node->parent;
-
-        size_t index = 0;
-        for (size_t i = 0; i < parent->child_count; i++) {
-            if (parent->children[i] == node) {
-                index = i;
-                break;
-            }
+    if (entry->rects == NULL
+        || entry->arrangedSize.width != node->calculatedRect.width
+        || entry->arrangedSize.height != node->calculatedRect.height) {
+
+        // seen before, so lay this one out normally and record it when done
+        if (memoPendingNode == NANOGRAPH_NULL_HANDLE) {
+            memoPendingNode = node->handle;
+            memoPendingDepth = downStackSize;
         }
 
-        // If there is a next sibling, return it
-        if (index + 1 < parent->child_count) {
-            return parent->children[index + 1];
+        memoStats.misses++;
+        return 0;
+    }
+
+    // identical inputs and size, so the arrangement only needs translating
+    size_t i = 0;
+    for (nGraphNode* child = NextInSubtree(node, node); child != NULL; child = NextInSubtree(child, node)) {
+        nGraphRect oldRect = child->calculatedRect;
+
+        child->calculatedRect = entry->rects[i++];
+        child->calculatedRect.x += node->calculatedRect.x;
+        child->calculatedRect.y += node->calculatedRect.y;
+        child->arrangeDeferred = 0;
+
+        if (collectingLayoutEvents) {
+            QueueLayoutEvent(child, oldRect);
         }
+    }
 
-        // Move up to the parent node
-        node = parent;
+    memoStats.arrangeHits++;
+    return 1;
+}
+
+void RecordMemoArrangement(nGraphNode* node)
+{
+    MemoEntry* entry = FindMemoEntry(node);
+    if (entry == NULL) return;
+
+    // a subtree with culled descendants has no complete arrangement to record
+    for (nGraphNode* child = NextInSubtree(node, node); child != NULL; child = NextInSubtree(child, node)) {
+        if (child->arrangeDeferred) return;
     }
 
-    // If no next node is found, return NULL
-    return NULL;
+    if (entry->rects == NULL) {
+        entry->rects = (nGraphRect*)malloc((entry->nodeCount - 1) * sizeof(nGraphRect));
+    }
+
+    size_t i = 0;
+    for (nGraphNode* child = NextInSubtree(node, node); child != NULL; child = NextInSubtree(child, node)) {
+        entry->rects[i] = child->calculatedRect;
+        entry->rects[i].x -= node->calculatedRect.x;
+        entry->rects[i].y -= node->calculatedRect.y;
+        i++;
+    }
+
+    entry->arrangedSize.width = node->calculatedRect.width;
+    entry->arrangedSize.height = node->calculatedRect.height;
 }
 
+void* GrowTable(void* table, size_t* capacity, size_t elementSize, size_t required)
+{
+    if (required <= *capacity) return table;
 
-/******************************************************************************
- * MARK: LOCAL FUNCTION IMPLEMENTATIONS
- *****************************************************************************/
+    size_t newCapacity = (*capacity == 0) ? TABLE_BLOCK_SIZE : *capacity;
+    while (newCapacity < required) {
+        newCapacity *= 2;
+    }
+
+    table = realloc(table, newCapacity * elementSize);
+    *capacity = newCapacity;
 
+    return table;
+}
 
-// Initialize the up and down stacks
+// Initialize the measure and down stacks
 void InitializeStacks(size_t initialCapacity) {
     downStatckCapacity = initialCapacity;
     downStackSize = 0;
-    downStack = (nGraphNode_h *)malloc(downStatckCapacity * sizeof(nGraphNode_h));
+    downStack = (nGraphNode**)malloc(downStatckCapacity * sizeof(nGraphNode*));
+    downClipStack = (ClipBounds *)malloc(downStatckCapacity * sizeof(ClipBounds));
 
-    upStatckCapacity = initialCapacity;
-    upStackSize = 0;
-    upStack = (nGraphNode_h *)malloc(upStatckCapacity * sizeof(nGraphNode_h));
+    measureStackCapacity = initialCapacity;
+    measureStackSize = 0;
+    measureStack = (MeasureFrame*)malloc(measureStackCapacity * sizeof(MeasureFrame));
 }
 
 // Free the stacks when no longer needed
 void FreeStacks() {
     free(downStack);
-    free(upStack);
+    free(downClipStack);
+    free(measureStack);
 }
 
 // Push a node onto the down stack
-void DownStack_Push(nGraphNode_h node) {
+void DownStack_Push(nGraphNode* node) {
     if (downStackSize < downStatckCapacity) {
         downStack[downStackSize++] = node;
     } else {
@@ -225,7 +1627,7 @@ void DownStack_Push(nGraphNode_h node) {
 }
 
 // Pop a node from the down stack
-nGraphNode_h DownStack_Pop() {
+nGraphNode* DownStack_Pop() {
     if (downStackSize == 0) return NULL;
     return downStack[--downStackSize];
 }
@@ -235,28 +1637,197 @@ int DownStack_IsEmpty() {
     return downStackSize == 0;
 }
 
-// Push a node onto the up stack
-void UpStack_Push(nGraphNode_h node) {
-    if (upStackSize < upStatckCapacity) {
-        upStack[upStackSize++] = node;
+// Push a node onto the down stack along with its inherited clip bounds
+void DownStack_PushClipped(nGraphNode* node, ClipBounds clip) {
+    if (downStackSize < downStatckCapacity) {
+        downClipStack[downStackSize] = clip;
+    }
+    DownStack_Push(node);
+}
+
+// Pop a node from the down stack along with its inherited clip bounds
+nGraphNode* DownStack_PopClipped(ClipBounds* clip) {
+    if (downStackSize == 0) return NULL;
+    *clip = downClipStack[downStackSize - 1];
+    return DownStack_Pop();
+}
+
+// Reverse the down stack above start so siblings pop in document order
+void DownStack_ReverseFrom(size_t start) {
+    size_t end = downStackSize;
+    while (end > start + 1) {
+        --end;
+
+        nGraphNode* node = downStack[start];
+        downStack[start] = downStack[end];
+        downStack[end] = node;
+
+        ClipBounds clip = downClipStack[start];
+        downClipStack[start] = downClipStack[end];
+        downClipStack[end] = clip;
+
+        ++start;
+    }
+}
+
+// Push a node onto the measure stack, before its children are measured
+void MeasureStack_Push(nGraphNode* node) {
+    if (measureStackSize < measureStackCapacity) {
+        MeasureFrame* frame = &measureStack[measureStackSize++];
+        frame->node = node;
+        frame->nextChild = NodeAt(node->firstChild);
+        frame->remaining = ChildAvailableSize(node);
     } else {
         // Handle stack overflow (log an error or take appropriate action)
-        fprintf(stderr, "Up stack overflow\n");
+        fprintf(stderr, "Measure stack overflow\n");
+    }
+}
+
+void ArrangeSubtree(nGraphNode* root, ClipBounds clip, int cull)
+{
+    collectingLayoutEvents = (liveSubscriptions > 0);
+    size_t batchStart = layoutEventCount;
+
+    DownStack_PushClipped(root, clip);
+
+    while (!DownStack_IsEmpty()) {
+        // the pending memo subtree is complete once the stack drops back below it
+        if (memoPendingNode != NANOGRAPH_NULL_HANDLE && downStackSize <= memoPendingDepth) {
+            RecordMemoArrangement(Resolve(memoPendingNode));
+            memoPendingNode = NANOGRAPH_NULL_HANDLE;
+        }
+
+        nGraphNode* node = DownStack_PopClipped(&clip);
+        node->arrangeDeferred = 0;
+
+        if (memoArrangeActive && ApplyMemoArrangement(node)) {
+            continue;
+        }
+
+        if (collectingLayoutEvents) {
+            SnapshotChildRects(node);
+            LayoutNode(node);
+            CollectChildChanges(node);
+        } else {
+            LayoutNode(node);
+        }
+
+        if (cull && node->clipChildren) {
+            clip = ClipToRect(clip, node->calculatedRect);
+        }
+
+        // children whose rects the layout doesn't assign can't be judged
+        int childRectsAssigned = AssignsChildRects(node);
+
+        // Push children onto the down stack, then reverse them so the first child pops first
+        size_t firstPushed = downStackSize;
+        for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
+
+            /* children entirely outside the clip keep the rect assigned by
+            ** LayoutNode, but their own subtree is left until it is visible
+            ** or queried through NanoGraph_ArrangeDeferred.
+            */
+            if (cull && childRectsAssigned && !RectIntersectsClip(child->calculatedRect, clip)) {
+                child->arrangeDeferred = 1;
+                continue;
+            }
+
+            DownStack_PushClipped(child, clip);
+        }
+        DownStack_ReverseFrom(firstPushed);
+    }
+
+    if (memoPendingNode != NANOGRAPH_NULL_HANDLE) {
+        RecordMemoArrangement(Resolve(memoPendingNode));
+        memoPendingNode = NANOGRAPH_NULL_HANDLE;
     }
+
+    if (collectingLayoutEvents) {
+        collectingLayoutEvents = 0;
+        EndLayoutBatch(RootOf(root)->handle, batchStart);
+        DeliverLayoutEvents();
+    }
+}
+
+ClipBounds ClipToRect(ClipBounds clip, nGraphRect rect)
+{
+    clip.left = fmaxf(clip.left, rect.x);
+    clip.top = fmaxf(clip.top, rect.y);
+    clip.right = fminf(clip.right, rect.x + rect.width);
+    clip.bottom = fminf(clip.bottom, rect.y + rect.height);
+    return clip;
+}
+
+int RectIntersectsClip(nGraphRect rect, ClipBounds clip)
+{
+    // edges are inclusive so zero-sized children inside the clip stay visible
+    return rect.x <= clip.right && rect.x + rect.width >= clip.left
+        && rect.y <= clip.bottom && rect.y + rect.height >= clip.top;
+}
+
+int AssignsChildRects(nGraphNode* node)
+{
+    // only stack and dock layouts position their children
+    return node->parentLayout == LAYOUT_STACK || node->parentLayout == LAYOUT_DOCK;
+}
+
+nGraphSize ChildAvailableSize(nGraphNode* node)
+{
+    nGraphSize available;
+    available.width = fmaxf(0, node->availableSize.width - (node->padding.left + node->padding.right));
+    available.height = fmaxf(0, node->availableSize.height - (node->padding.top + node->padding.bottom));
+
+    // stacks give their children unlimited space along the stack orientation
+    if (node->parentLayout == LAYOUT_STACK) {
+        if (node->parentStackOrientation == STACK_HORIZONTAL) {
+            available.width = INFINITY;
+        } else {
+            available.height = INFINITY;
+        }
+    }
+
+    return available;
 }
 
-// Pop a node from the up stack
-nGraphNode_h UpStack_Pop() {
-    if (upStackSize == 0) return NULL;
-    return upStack[--upStackSize];
+void ConsumeDockSpace(MeasureFrame* frame, nGraphNode* child)
+{
+    if (frame->node->parentLayout != LAYOUT_DOCK) return;
+
+    switch (child->childDockPosition) {
+        case DOCK_LEFT:
+        case DOCK_RIGHT:
+        {
+            frame->remaining.width = fmaxf(0, frame->remaining.width - child->calculatedSize.width);
+        } break;
+        case DOCK_TOP:
+        case DOCK_BOTTOM:
+        {
+            frame->remaining.height = fmaxf(0, frame->remaining.height - child->calculatedSize.height);
+        } break;
+    }
 }
 
-// Check if the up stack is empty
-int UpStack_IsEmpty() {
-    return upStackSize == 0;
+int SameMeasureResult(nGraphNode* node, nGraphSize available)
+{
+    if (available.width == node->availableSize.width && available.height == node->availableSize.height) {
+        return 1;
+    }
+
+    // children of an interior node would see a different constraint
+    if (node->firstChild != NANOGRAPH_NULL_INDEX) return 0;
+
+    /* a leaf's size only depends on the constraint when it was clamped, so an
+    ** unclamped result that still fits the new constraint is unchanged.
+    */
+    int sameWidth = (available.width == node->availableSize.width)
+                 || (node->calculatedSize.width < node->availableSize.width && node->calculatedSize.width <= available.width);
+    int sameHeight = (available.height == node->availableSize.height)
+                  || (node->calculatedSize.height < node->availableSize.height && node->calculatedSize.height <= available.height);
+
+    return sameWidth && sameHeight;
 }
 
-void MeasureNode(nGraphNode_h node)
+void MeasureNode(nGraphNode* node)
 {
     switch (node->parentLayout) 
     {
@@ -272,16 +1843,16 @@ void MeasureNode(nGraphNode_h node)
                 {
                     node->calculatedSize.width = 0;
                     node->calculatedSize.height = node->userRect.height;
-                    for (size_t i = 0; i < node->child_count; i++) {
-                        node->calculatedSize.width += node->children[i]->calculatedSize.width;
+                    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
+                        node->calculatedSize.width += child->calculatedSize.width;
                     }
                 } break;
                 case STACK_VERTICAL:
                 {
                     node->calculatedSize.width = node->userRect.width;
                     node->calculatedSize.height = 0;
-                    for (size_t i = 0; i < node->child_count; i++) {
-                        node->calculatedSize.height += node->children[i]->calculatedSize.height;
+                    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
+                        node->calculatedSize.height += child->calculatedSize.height;
                     }
                 } break;
             }
@@ -301,8 +1872,7 @@ void MeasureNode(nGraphNode_h node)
             node->calculatedSize.width = node->userRect.width;
             node->calculatedSize.height = node->userRect.height;
 
-            for (size_t i = 0; i < node->child_count; i++) {
-                nGraphNode_h child = node->children[i];
+            for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
                 switch (child->childDockPosition) {
                     case DOCK_LEFT:
                     case DOCK_RIGHT:
@@ -346,13 +1916,17 @@ void MeasureNode(nGraphNode_h node)
             
     }
 
+    /* clamp the result to the space the parent offers */
+    node->calculatedSize.width = fminf(node->calculatedSize.width, node->availableSize.width);
+    node->calculatedSize.height = fminf(node->calculatedSize.height, node->availableSize.height);
+
     //printf("MEASURED '%s' with ID %lu as (%f, %f)\n",
     //        node->name,
     //       node,
     //       node->calculatedSize.width, node->calculatedSize.height);    
 }
 
-void LayoutNode(nGraphNode_h node)
+void LayoutNode(nGraphNode* node)
 {
     switch (node->parentLayout) 
     {
@@ -366,8 +1940,7 @@ void LayoutNode(nGraphNode_h node)
             {
                 case STACK_HORIZONTAL:
                 {
-                    for (size_t i = 0; i < node->child_count; i++) {
-                        nGraphNode_h child = node->children[i];
+                    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
                         child->calculatedRect.x = currentX;
                         child->calculatedRect.width = child->calculatedSize.width;
                         currentX += child->calculatedRect.width;
@@ -398,8 +1971,7 @@ void LayoutNode(nGraphNode_h node)
                 } break;
                 case STACK_VERTICAL:
                 {
-                    for (size_t i = 0; i < node->child_count; i++) {
-                        nGraphNode_h child = node->children[i];
+                    for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) {
                         child->calculatedRect.y = currentY;
                         child->calculatedRect.height = child->calculatedSize.height;
                         currentY += child->calculatedRect.height;
@@ -441,10 +2013,9 @@ void LayoutNode(nGraphNode_h node)
             float right = left + node->calculatedRect.width;
             float bottom = top + node->calculatedRect.height;
 
-            for (size_t i = 0; i < node->child_count; i++) 
+            for (nGraphNode* child = NodeAt(node->firstChild); child != NULL; child = NodeAt(child->next)) 
             {
-                nGraphNode_h child = node->children[i];
-                if (i < node->child_count - 1) 
+                if (child->next != NANOGRAPH_NULL_INDEX) 
                 {
                     /* not last child */
                     switch (child->childDockPosition) 
@@ -7,7 +7,20 @@
 
 #include <NanoDrawing.h>
 
-typedef struct nGraphNode* nGraphNode_h;
+/* Handles stay valid for the lifetime of a node, while node storage may be
+** moved by insertion and compaction. Links between nodes are slot indices.
+** A handle carries a generation, so once its node is removed it resolves to
+** nothing rather than to a later node, and the same goes for subscriptions.
+*/
+typedef uint32_t nGraphNode_h;
+
+typedef uint32_t nGraphNodeIndex;
+
+typedef uint32_t nGraphSubscription;
+
+#define NANOGRAPH_NULL_INDEX 0
+
+#define NANOGRAPH_NULL_HANDLE 0
 
 typedef enum
 {   
@@ -58,10 +71,10 @@ typedef enum
 
 typedef struct 
 {
-    size_t row;
-    size_t column;
-    size_t rowSpan;
-    size_t columnSpan;
+    uint16_t row;
+    uint16_t column;
+    uint16_t rowSpan;
+    uint16_t columnSpan;
 } nGraphChildGridPosition;
 
 typedef enum
@@ -102,45 +115,146 @@ typedef struct
     float height;
 } nGraphSize;
 
-typedef struct nGraphNode 
+typedef struct
 {
+    size_t arrangeHits;
+    size_t misses;
+    size_t evictions;
+    size_t entries;
+} nGraphMemoStats;
 
-    const char* name;
-    
-    nGraphParentLayout parentLayout;
+/* Per-node byte budget: a fixed 128 bytes of layout state and links plus the
+** inline background colour. The rects, sizes and thicknesses a pass reads take
+** 80 bytes, and the 128 bytes hold them with the name, the grid position, five
+** 32-bit links, two side table slots and the packed flags. New per-node state has to fit in the
+** remaining bytes or go out-of-line. Outside the budget, the handle map costs
+** 4 bytes per node.
+*/
+#define NANOGRAPH_NODE_BYTE_BUDGET (128 + sizeof(nDrawColor))
 
-    nGraphParentStackOrientation parentStackOrientation;
-    nGraphParentGridProperties parentGridProperties;
+typedef struct nGraphNode 
+{
 
-    nGraphChildDockPosition childDockPosition;
-    nGraphChildGridPosition childGridPosition;
-    nGraphChildHorizontalAlignment childHorizontalAlignment;
-    nGraphChildVerticalAlignment childVerticalAlignment;
+    const char* name;
 
     nGraphRect userRect;
 
+    nGraphSize availableSize;
     nGraphSize calculatedSize;
     nGraphRect calculatedRect;
 
     nGraphThickness margin;
     nGraphThickness padding;
 
+    nGraphChildGridPosition childGridPosition;
+
     nDrawColor backgroundColor;
-    nDrawing drawing;
-    
-    nGraphNode_h parent;
-    nGraphNode_h next;
-    nGraphNode_h* children;
-    size_t child_count;
+
+    nGraphNode_h handle;
+    nGraphNodeIndex parent;
+    nGraphNodeIndex firstChild;
+    nGraphNodeIndex lastChild;
+    nGraphNodeIndex next;
+
+    uint32_t gridIndex;
+    uint32_t drawingIndex;
+
+    unsigned int parentLayout : 2;
+    unsigned int parentStackOrientation : 1;
+    unsigned int childDockPosition : 2;
+    unsigned int childHorizontalAlignment : 2;
+    unsigned int childVerticalAlignment : 2;
+
+    unsigned int clipChildren : 1;
+    unsigned int arrangeDeferred : 1;
+    unsigned int measureDirty : 1;
+    unsigned int hasSubscriber : 1;
 } nGraphNode;
 
+typedef struct
+{
+    nGraphNode_h node;
+    nGraphRect oldRect;
+    nGraphRect newRect;
+} nGraphLayoutEvent;
+
+/* Events from a layout pass are delivered once the pass ends. Passes run from
+** a callback are delivered as further batches after the current one.
+*/
+typedef void (*nGraphLayoutCallback)(const nGraphLayoutEvent* events, size_t count, void* userData);
+
 nGraphNode_h NanoGraph_CreateRootNode();
 
 nGraphNode_h NanoGraph_InsertNode(nGraphNode_h parent);
 
+void NanoGraph_RemoveNode(nGraphNode_h node);
+
 void NanoGraph_Recalculate(nGraphNode_h node);
 
+void NanoGraph_RecalculateWithSize(nGraphNode_h node, nGraphSize availableSize);
+
+/* With caching on, clean subtrees keep their measured sizes. Code that writes
+** node fields such as userRect, padding or the layout enums directly must call
+** NanoGraph_InvalidateMeasure on the node afterwards.
+*/
+void NanoGraph_SetMeasureCaching(int enabled);
+
+void NanoGraph_InvalidateMeasure(nGraphNode_h node);
+
+/* Rewrites node storage so every graph is contiguous in depth-first order.
+** Handles stay valid, pointers from NanoGraph_GetNode must be re-resolved.
+*/
+void NanoGraph_Compact();
+
+float NanoGraph_GetFragmentation(nGraphNode_h root);
+
+/* Recalculating a graph whose fragmentation exceeds the threshold compacts the
+** whole store, so every graph is rewritten, not only the one recalculated.
+*/
+void NanoGraph_SetCompactionThreshold(float threshold);
+
 nGraphNode_h NanoGraph_GetNextNode(nGraphNode_h node);
 
+/* The pointer is valid until the next insertion or compaction, including the
+** automatic compaction done by NanoGraph_Recalculate.
+*/
+nGraphNode* NanoGraph_GetNode(nGraphNode_h node);
+
+nGraphNode_h NanoGraph_GetParent(nGraphNode_h node);
+
+nGraphNode_h NanoGraph_GetFirstChild(nGraphNode_h node);
+
+nGraphNode_h NanoGraph_GetNextSibling(nGraphNode_h node);
+
+void NanoGraph_SetGridProperties(nGraphNode_h node, nGraphParentGridProperties properties);
+
+nGraphParentGridProperties* NanoGraph_GetGridProperties(nGraphNode_h node);
+
+void NanoGraph_SetDrawing(nGraphNode_h node, nDrawing drawing);
+
+nDrawing* NanoGraph_GetDrawing(nGraphNode_h node);
+
+void NanoGraph_SetName(nGraphNode_h node, const char* name);
+
+nGraphNode_h NanoGraph_FindNode(nGraphNode_h root, const char* name);
+
+size_t NanoGraph_FindNodes(nGraphNode_h root, const char* name, nGraphNode_h* nodes, size_t maxNodes);
+
+nGraphSubscription NanoGraph_SubscribeNode(nGraphNode_h node, nGraphLayoutCallback callback, void* userData);
+
+nGraphSubscription NanoGraph_SubscribeGraph(nGraphNode_h root, nGraphLayoutCallback callback, void* userData);
+
+void NanoGraph_Unsubscribe(nGraphSubscription subscription);
+
+void NanoGraph_SetSubtreeMemoisation(size_t capacity);
+
+nGraphMemoStats NanoGraph_GetMemoStats();
+
+void NanoGraph_SetClipCulling(int enabled);
+
+void NanoGraph_ArrangeDeferred(nGraphNode_h node);
+
+nGraphRect NanoGraph_GetCalculatedRect(nGraphNode_h node);
+
 
 #endif // NANOGRAH_H
\ No newline at end of file